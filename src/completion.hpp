@@ -0,0 +1,179 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+/*
+ * completion.hpp
+ *
+ * Adapts asio completion handlers (including the move only ones produced by use_awaitable) to the
+ * boost::function completions the producer stores. The wrapper's own state lives in recycled memory,
+ * so once warm it adds no heap allocation, what the wrapped operation itself allocates is another matter.
+ */
+
+#ifndef KAFKA_COMPLETION_HPP_
+#define KAFKA_COMPLETION_HPP_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include <boost/asio.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace kafkaconnect {
+namespace detail {
+
+/*
+ * A handful of freed blocks are kept per thread and handed back out to any allocation that fits, the
+ * same trick asio uses for its own handlers and coroutine frames. Blocks freed on another thread simply
+ * join that thread's cache.
+ */
+class recycling_cache
+{
+public:
+	static void* allocate(std::size_t size)
+	{
+		void** blocks = instance().blocks;
+		for (std::size_t i = 0; i < slots; ++i)
+		{
+			if (blocks[i] != NULL && capacity(blocks[i]) >= size)
+			{
+				void* block = blocks[i];
+				blocks[i] = NULL;
+				return static_cast<char*>(block) + header_size;
+			}
+		}
+
+		void* block = ::operator new(size + header_size);
+		*static_cast<std::size_t*>(block) = size;
+		return static_cast<char*>(block) + header_size;
+	}
+
+	static void deallocate(void* pointer)
+	{
+		void* block = static_cast<char*>(pointer) - header_size;
+		void** blocks = instance().blocks;
+		for (std::size_t i = 0; i < slots; ++i)
+		{
+			if (blocks[i] == NULL)
+			{
+				blocks[i] = block;
+				return;
+			}
+		}
+
+		::operator delete(block);
+	}
+
+private:
+	static const std::size_t slots = 8;
+	static const std::size_t header_size = alignof(std::max_align_t);
+
+	struct cache
+	{
+		cache() { for (std::size_t i = 0; i < slots; ++i) { blocks[i] = NULL; } }
+		~cache() { for (std::size_t i = 0; i < slots; ++i) { ::operator delete(blocks[i]); } }
+
+		void* blocks[slots];
+	};
+
+	static cache& instance()
+	{
+		static thread_local cache thread_cache;
+		return thread_cache;
+	}
+
+	static std::size_t capacity(void* block) { return *static_cast<std::size_t*>(block); }
+};
+
+template <typename T>
+class recycling_allocator
+{
+public:
+	typedef T value_type;
+
+	recycling_allocator() {}
+	template <typename U> recycling_allocator(const recycling_allocator<U>&) {}
+
+	T* allocate(std::size_t count) { return static_cast<T*>(recycling_cache::allocate(sizeof(T) * count)); }
+	void deallocate(T* pointer, std::size_t) { recycling_cache::deallocate(pointer); }
+
+	template <typename U> bool operator==(const recycling_allocator<U>&) const { return true; }
+	template <typename U> bool operator!=(const recycling_allocator<U>&) const { return false; }
+};
+
+/*
+ * Copyable wrapper around a single use completion handler. Invoking it posts the handler to its
+ * associated executor, so a resumed coroutine never runs from inside the producer's own io handlers,
+ * and the handler's executor is kept busy until then.
+ */
+template <typename Handler, typename Executor>
+class shared_completion
+{
+public:
+	typedef typename boost::asio::associated_executor<Handler, Executor>::type executor_type;
+
+	shared_completion(Handler&& handler, const Executor& fallback)
+		: _state(boost::allocate_shared<state>(recycling_allocator<state>(), std::move(handler), fallback))
+	{
+	}
+
+	void operator()(const boost::system::error_code& error_code) const
+	{
+		executor_type executor = _state->work.get_executor();
+		boost::asio::post(executor, invoker(_state, error_code));
+	}
+
+private:
+	struct state
+	{
+		state(Handler&& handler, const Executor& fallback)
+			: work(boost::asio::get_associated_executor(handler, fallback))
+			, handler(std::move(handler))
+		{
+		}
+
+		boost::asio::executor_work_guard<executor_type> work;
+		Handler handler;
+	};
+
+	struct invoker
+	{
+		invoker(const boost::shared_ptr<state>& state, const boost::system::error_code& error_code) : _state(state), _error_code(error_code) {}
+
+		void operator()()
+		{
+			// release our hold on the executor before handing control back to the caller
+			boost::shared_ptr<state> state;
+			state.swap(_state);
+			Handler handler(std::move(state->handler));
+			state->work.reset();
+			state.reset();
+
+			std::move(handler)(_error_code);
+		}
+
+		boost::shared_ptr<state> _state;
+		boost::system::error_code _error_code;
+	};
+
+	boost::shared_ptr<state> _state;
+};
+
+}
+}
+
+#endif /* KAFKA_COMPLETION_HPP_ */
@@ -0,0 +1,95 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+/*
+ * decoder.hpp
+ */
+
+#ifndef KAFKA_DECODER_HPP_
+#define KAFKA_DECODER_HPP_
+
+#include <istream>
+#include <string>
+
+#include <arpa/inet.h>
+#include <stdint.h>
+
+namespace kafkaconnect {
+namespace test { class decoder_helper; }
+
+class decoder_helper
+{
+private:
+	friend class test::decoder_helper;
+	friend bool decode_produce_response(std::istream&, int32_t&, int16_t&);
+
+	template <typename Data>
+	static bool raw(std::istream& stream, Data& data)
+	{
+		return !stream.read(reinterpret_cast<char*>(&data), sizeof(Data)).fail();
+	}
+
+	static bool skip_string(std::istream& stream)
+	{
+		uint16_t length;
+		if (!raw(stream, length)) { return false; }
+		return !stream.ignore(ntohs(length)).fail();
+	}
+};
+
+/*
+ * Decodes a produce response body (everything after the 4 byte size), setting the correlation id and the
+ * first non zero error code of any partition in the response. Returns false if the response is truncated.
+ */
+inline bool decode_produce_response(std::istream& stream, int32_t& correlation_id, int16_t& error_code)
+{
+	error_code = 0;
+
+	// Response format is ... correlation id (4 bytes)
+	if (!decoder_helper::raw(stream, correlation_id)) { return false; }
+	correlation_id = ntohl(correlation_id);
+
+	// ... topic count (4 bytes)
+	uint32_t topic_count;
+	if (!decoder_helper::raw(stream, topic_count)) { return false; }
+
+	for (uint32_t topic = 0; topic < ntohl(topic_count); ++topic)
+	{
+		// ... topic string size (2 bytes) & topic string, partition count (4 bytes)
+		uint32_t partition_count;
+		if (!decoder_helper::skip_string(stream) || !decoder_helper::raw(stream, partition_count)) { return false; }
+
+		for (uint32_t partition = 0; partition < ntohl(partition_count); ++partition)
+		{
+			// ... partition (4 bytes), error code (2 bytes) & offset (8 bytes)
+			uint32_t partition_id;
+			int16_t partition_error;
+			uint64_t offset;
+			if (!decoder_helper::raw(stream, partition_id) || !decoder_helper::raw(stream, partition_error) || !decoder_helper::raw(stream, offset))
+			{
+				return false;
+			}
+
+			if (error_code == 0) { error_code = ntohs(partition_error); }
+		}
+	}
+
+	return true;
+}
+
+}
+
+#endif /* KAFKA_DECODER_HPP_ */
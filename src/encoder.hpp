@@ -57,6 +57,51 @@ void encode(std::ostream& stream, const std::string& topic, const uint32_t parti
 	}
 }
 
+template <typename List>
+void encode(std::ostream& stream, const int32_t correlation_id, const std::string& client_id, const int16_t required_acks, const int32_t timeout, const std::string& topic, const uint32_t partition, const List& messages)
+{
+	// Pre-calculate size of message set
+	uint32_t messageset_size = 0;
+	BOOST_FOREACH(const std::string& message, messages)
+	{
+		messageset_size += versioned_message_format_header_size + message.length();
+	}
+
+	// Packet format is ... packet size (4 bytes)
+	encoder_helper::raw(stream, htonl(2 + 2 + 4 + 2 + client_id.size() + 2 + 4 + 4 + 2 + topic.size() + 4 + 4 + 4 + messageset_size));
+
+	// ... request key & version (2 bytes each)
+	encoder_helper::raw(stream, htons(produce_request_key));
+	encoder_helper::raw(stream, htons(produce_request_version));
+
+	// ... correlation id (4 bytes)
+	encoder_helper::raw(stream, htonl(correlation_id));
+
+	// ... client id string size (2 bytes) & client id string
+	encoder_helper::raw(stream, htons(client_id.size()));
+	stream << client_id;
+
+	// ... required acks (2 bytes) & broker side timeout in ms (4 bytes)
+	encoder_helper::raw(stream, htons(required_acks));
+	encoder_helper::raw(stream, htonl(timeout));
+
+	// ... topic count (4 bytes), topic string size (2 bytes) & topic string
+	encoder_helper::raw(stream, htonl(1));
+	encoder_helper::raw(stream, htons(topic.size()));
+	stream << topic;
+
+	// ... partition count (4 bytes) & partition (4 bytes)
+	encoder_helper::raw(stream, htonl(1));
+	encoder_helper::raw(stream, htonl(partition));
+
+	// ... message set size (4 bytes) and message set
+	encoder_helper::raw(stream, htonl(messageset_size));
+	BOOST_FOREACH(const std::string& message, messages)
+	{
+		encoder_helper::versioned_message(stream, message);
+	}
+}
+
 }
 
 #endif /* KAFKA_ENCODER_HPP_ */
@@ -41,11 +41,18 @@ const uint8_t message_format_magic_number = 0;
 const uint8_t message_format_extra_data_size = 1 + 4;
 const uint8_t message_format_header_size = message_format_extra_data_size + 4;
 
+const int16_t produce_request_key = 0;
+const int16_t produce_request_version = 0;
+
+const uint8_t versioned_message_format_extra_data_size = 4 + 1 + 1 + 4 + 4;
+const uint8_t versioned_message_format_header_size = 8 + 4 + versioned_message_format_extra_data_size;
+
 class encoder_helper
 {
 private:
 	friend class test::encoder_helper;
 	template <typename T> friend void encode(std::ostream&, const std::string&, const uint32_t, const T&);
+	template <typename T> friend void encode(std::ostream&, const int32_t, const std::string&, const int16_t, const int32_t, const std::string&, const uint32_t, const T&);
 
 	static std::ostream& message(std::ostream& stream, const std::string message)
 	{
@@ -66,6 +73,39 @@ private:
 		return stream;
 	}
 
+	static std::ostream& versioned_message(std::ostream& stream, const std::string message)
+	{
+		const uint8_t attributes = 0;
+		const int32_t null_key = -1;
+
+		// Versioned message format is ... offset, ignored by the broker on produce (8 bytes)
+		raw(stream, static_cast<uint64_t>(0));
+
+		// ... message size (4 bytes)
+		raw(stream, htonl(versioned_message_format_extra_data_size + message.length()));
+
+		// ... crc32 of everything that follows (4 bytes)
+		boost::crc_32_type result;
+		result.process_byte(message_format_magic_number);
+		result.process_byte(attributes);
+		const uint32_t key_length = htonl(null_key);
+		result.process_bytes(&key_length, sizeof(key_length));
+		const uint32_t message_length = htonl(message.length());
+		result.process_bytes(&message_length, sizeof(message_length));
+		result.process_bytes(message.c_str(), message.length());
+		raw(stream, htonl(result.checksum()));
+
+		// ... magic number & attributes (1 byte each)
+		stream << message_format_magic_number << attributes;
+
+		// ... null key (4 bytes), message size (4 bytes) & message string bytes
+		raw(stream, key_length);
+		raw(stream, message_length);
+		stream << message;
+
+		return stream;
+	}
+
 	template <typename Data>
 	static std::ostream& raw(std::ostream& stream, const Data& data)
 	{
@@ -0,0 +1,81 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+/*
+ * encoder_pool.cpp
+ */
+
+#include <boost/bind.hpp>
+
+#include "encoder_pool.hpp"
+
+namespace kafkaconnect {
+
+encoder_pool::encoder_pool(const size_t threads)
+	: _stopping(false)
+{
+	for (size_t i = 0; i < threads; ++i)
+	{
+		_threads.create_thread(boost::bind(&encoder_pool::run, this));
+	}
+}
+
+encoder_pool::~encoder_pool()
+{
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_stopping = true;
+	}
+
+	_condition.notify_all();
+	_threads.join_all();
+}
+
+void encoder_pool::submit(const job_function& job)
+{
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_jobs.push_back(job);
+	}
+
+	_condition.notify_one();
+}
+
+void encoder_pool::run()
+{
+	for (;;)
+	{
+		job_function job;
+
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			while (_jobs.empty() && !_stopping)
+			{
+				_condition.wait(lock);
+			}
+
+			// drain whatever is queued before stopping so no submitted request is lost
+			if (_jobs.empty()) { return; }
+
+			job.swap(_jobs.front());
+			_jobs.pop_front();
+		}
+
+		job();
+	}
+}
+
+}
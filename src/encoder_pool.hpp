@@ -0,0 +1,58 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+/*
+ * encoder_pool.hpp
+ */
+
+#ifndef KAFKA_ENCODER_POOL_HPP_
+#define KAFKA_ENCODER_POOL_HPP_
+
+#include <deque>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+namespace kafkaconnect {
+
+/*
+ * A fixed set of worker threads taking jobs from a shared queue. Jobs may finish in any order, callers
+ * that need ordering must restore it themselves. Destroying the pool runs any queued jobs then joins.
+ */
+class encoder_pool : private boost::noncopyable
+{
+public:
+	typedef boost::function<void()> job_function;
+
+	explicit encoder_pool(const size_t threads);
+	~encoder_pool();
+
+	void submit(const job_function& job);
+
+private:
+	boost::mutex _mutex;
+	boost::condition_variable _condition;
+	std::deque<job_function> _jobs;
+	bool _stopping;
+	boost::thread_group _threads;
+
+	void run();
+};
+
+}
+
+#endif /* KAFKA_ENCODER_POOL_HPP_ */
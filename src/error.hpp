@@ -0,0 +1,93 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+/*
+ * error.hpp
+ */
+
+#ifndef KAFKA_ERROR_HPP_
+#define KAFKA_ERROR_HPP_
+
+#include <string>
+
+#include <boost/system/error_code.hpp>
+
+namespace kafkaconnect {
+namespace error {
+
+// Error codes returned by the broker in produce responses
+enum kafka_errors
+{
+	unknown = -1,
+	offset_out_of_range = 1,
+	invalid_message = 2,
+	unknown_topic_or_partition = 3,
+	invalid_message_size = 4,
+	leader_not_available = 5,
+	not_leader_for_partition = 6,
+	request_timed_out = 7,
+	broker_not_available = 8,
+	replica_not_available = 9,
+	message_size_too_large = 10,
+	stale_controller_epoch = 11,
+	offset_metadata_too_large = 12
+};
+
+class kafka_category_impl : public boost::system::error_category
+{
+public:
+	const char* name() const throw() { return "kafka"; }
+
+	std::string message(int value) const
+	{
+		switch (value)
+		{
+			case offset_out_of_range: return "Offset out of range";
+			case invalid_message: return "Invalid message";
+			case unknown_topic_or_partition: return "Unknown topic or partition";
+			case invalid_message_size: return "Invalid message size";
+			case leader_not_available: return "Leader not available";
+			case not_leader_for_partition: return "Not leader for partition";
+			case request_timed_out: return "Request timed out";
+			case broker_not_available: return "Broker not available";
+			case replica_not_available: return "Replica not available";
+			case message_size_too_large: return "Message size too large";
+			case stale_controller_epoch: return "Stale controller epoch";
+			case offset_metadata_too_large: return "Offset metadata too large";
+			default: return "Unknown kafka error";
+		}
+	}
+};
+
+inline const boost::system::error_category& kafka_category()
+{
+	static kafka_category_impl instance;
+	return instance;
+}
+
+inline boost::system::error_code make_error_code(kafka_errors value)
+{
+	return boost::system::error_code(static_cast<int>(value), kafka_category());
+}
+
+}
+}
+
+namespace boost { namespace system {
+template<> struct is_error_code_enum<kafkaconnect::error::kafka_errors> { static const bool value = true; };
+} }
+
+#endif /* KAFKA_ERROR_HPP_ */
@@ -0,0 +1,697 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+/*
+ * perf.cpp
+ *
+ * Load generator for the producer, either against a real broker or an embedded mock broker that parses
+ * every request so it can be run on a machine without kafka. Throughput counts completed sends and latency
+ * runs from send to completion, which is the broker's ack when acks are required.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "error.hpp"
+#include "producer.hpp"
+
+namespace {
+
+const boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+
+// matches the broker's default socket.request.max.bytes
+const uint32_t max_request_size = 100 * 1024 * 1024;
+
+int64_t now_micros()
+{
+	return (boost::posix_time::microsec_clock::universal_time() - start_time).total_microseconds();
+}
+
+/*
+ * Log linear latency histogram, values below 64us are exact and above that each power of two is split
+ * into 32 buckets so percentiles are within about 3% without keeping every sample.
+ */
+class histogram
+{
+public:
+	histogram() : _counts(27 << sub_bits, 0), _total(0), _max(0) {}
+
+	void record(uint32_t value)
+	{
+		++_counts[index(value)];
+		++_total;
+		_max = std::max(_max, value);
+	}
+
+	void merge(const histogram& other)
+	{
+		for (size_t i = 0; i < _counts.size(); ++i) { _counts[i] += other._counts[i]; }
+		_total += other._total;
+		_max = std::max(_max, other._max);
+	}
+
+	uint32_t percentile(double fraction) const
+	{
+		const uint64_t rank = static_cast<uint64_t>(fraction * (_total - 1)) + 1;
+		uint64_t seen = 0;
+		for (size_t i = 0; i < _counts.size(); ++i)
+		{
+			seen += _counts[i];
+			if (seen >= rank) { return std::min(value(i), _max); }
+		}
+		return _max;
+	}
+
+	uint64_t total() const { return _total; }
+	uint32_t max() const { return _max; }
+
+private:
+	static const unsigned sub_bits = 6;
+
+	std::vector<uint64_t> _counts;
+	uint64_t _total;
+	uint32_t _max;
+
+	static size_t index(uint32_t value)
+	{
+		if (value < (1u << sub_bits)) { return value; }
+		const unsigned shift = (31 - __builtin_clz(value)) - sub_bits + 1;
+		return (shift << sub_bits) + (value >> shift);
+	}
+
+	// upper bound of the bucket so percentiles never under report
+	static uint32_t value(size_t index)
+	{
+		const unsigned shift = index >> sub_bits;
+		if (shift == 0) { return index; }
+		return (((index & ((1u << sub_bits) - 1)) + 1) << shift) - 1;
+	}
+};
+
+class statistics
+{
+public:
+	statistics() : _sent_messages(0), _completed_messages(0), _completed_bytes(0), _errors(0) {}
+
+	void sent(size_t messages)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_sent_messages += messages;
+	}
+
+	void completed(size_t messages, size_t bytes, uint32_t latency)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_completed_messages += messages;
+		_completed_bytes += bytes;
+		_latency.record(latency);
+	}
+
+	void error()
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		++_errors;
+	}
+
+	static void header(std::ostream& stream)
+	{
+		stream << std::setw(8) << "time(s)" << std::setw(12) << "sent msg/s" << std::setw(12) << "done msg/s"
+			<< std::setw(10) << "done MB/s" << std::setw(10) << "p50(us)" << std::setw(10) << "p99(us)"
+			<< std::setw(10) << "p99.9(us)" << std::setw(10) << "max(us)" << std::setw(8) << "errors" << std::endl;
+	}
+
+	// prints the interval since the last report and folds it into the totals
+	void report(std::ostream& stream, double elapsed, double interval)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		line(stream, elapsed, interval, _sent_messages, _completed_messages, _completed_bytes, _latency, _errors);
+		fold();
+	}
+
+	// anything completing after the last report, such as the final flush, only counts towards the totals
+	void summary(std::ostream& stream, double elapsed)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		fold();
+		stream << "total:" << std::endl;
+		line(stream, elapsed, elapsed, _total.sent_messages, _total.completed_messages, _total.completed_bytes, _total.latency, _total.errors);
+	}
+
+private:
+	struct totals
+	{
+		totals() : sent_messages(0), completed_messages(0), completed_bytes(0), errors(0) {}
+
+		uint64_t sent_messages;
+		uint64_t completed_messages;
+		uint64_t completed_bytes;
+		uint64_t errors;
+		histogram latency;
+	};
+
+	boost::mutex _mutex;
+	uint64_t _sent_messages;
+	uint64_t _completed_messages;
+	uint64_t _completed_bytes;
+	uint64_t _errors;
+	histogram _latency;
+	totals _total;
+
+	void fold()
+	{
+		_total.sent_messages += _sent_messages;
+		_total.completed_messages += _completed_messages;
+		_total.completed_bytes += _completed_bytes;
+		_total.errors += _errors;
+		_total.latency.merge(_latency);
+
+		_sent_messages = _completed_messages = _completed_bytes = _errors = 0;
+		_latency = histogram();
+	}
+
+	static void line(std::ostream& stream, double elapsed, double interval, uint64_t sent_messages, uint64_t completed_messages, uint64_t completed_bytes, const histogram& latency, uint64_t errors)
+	{
+		stream << std::fixed << std::setprecision(1) << std::setw(8) << elapsed
+			<< std::setw(12) << std::setprecision(0) << sent_messages / interval
+			<< std::setw(12) << completed_messages / interval
+			<< std::setw(10) << std::setprecision(2) << completed_bytes / interval / (1024 * 1024);
+
+		if (latency.total() > 0)
+		{
+			stream << std::setw(10) << std::setprecision(0) << latency.percentile(0.5) << std::setw(10) << latency.percentile(0.99)
+				<< std::setw(10) << latency.percentile(0.999) << std::setw(10) << latency.max();
+		}
+		else
+		{
+			stream << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-";
+		}
+
+		stream << std::setw(8) << errors << std::endl;
+	}
+};
+
+/*
+ * Reads big endian fields out of a received request, every read is bounds checked so a malformed
+ * request just marks the reader as failed.
+ */
+class request_reader
+{
+public:
+	request_reader(const std::vector<char>& data) : _data(data), _position(0), _failed(false) {}
+
+	template <typename T>
+	T read()
+	{
+		T value = 0;
+		if (!require(sizeof(T))) { return value; }
+		for (size_t i = 0; i < sizeof(T); ++i)
+		{
+			value = (value << 8) | static_cast<uint8_t>(_data[_position++]);
+		}
+		return value;
+	}
+
+	void skip(size_t length) { if (require(length)) { _position += length; } }
+	size_t position() const { return _position; }
+	const char* at(size_t position) const { return &_data[position]; }
+	bool failed() const { return _failed; }
+
+private:
+	const std::vector<char>& _data;
+	size_t _position;
+	bool _failed;
+
+	bool require(size_t length)
+	{
+		if (_failed || _position + length > _data.size()) { _failed = true; }
+		return !_failed;
+	}
+};
+
+class mock_session : public boost::enable_shared_from_this<mock_session>
+{
+public:
+	mock_session(boost::asio::io_service& io_service, bool acknowledged)
+		: _socket(io_service)
+		, _acknowledged(acknowledged)
+	{
+	}
+
+	boost::asio::ip::tcp::socket& socket() { return _socket; }
+
+	void start()
+	{
+		boost::asio::async_read(
+			_socket, boost::asio::buffer(&_size, sizeof(_size)),
+			boost::bind(&mock_session::handle_size, shared_from_this(), boost::asio::placeholders::error)
+		);
+	}
+
+private:
+	boost::asio::ip::tcp::socket _socket;
+	bool _acknowledged;
+	uint32_t _size;
+	std::vector<char> _request;
+
+	void handle_size(const boost::system::error_code& error_code)
+	{
+		if (error_code) { return; }
+
+		const uint32_t size = ntohl(_size);
+		if (size > max_request_size)
+		{
+			reject("oversized request");
+			return;
+		}
+
+		_request.resize(size);
+		boost::asio::async_read(
+			_socket, boost::asio::buffer(_request),
+			boost::bind(&mock_session::handle_request, shared_from_this(), boost::asio::placeholders::error)
+		);
+	}
+
+	void handle_request(const boost::system::error_code& error_code)
+	{
+		if (error_code) { return; }
+
+		request_reader reader(_request);
+
+		if (!_acknowledged)
+		{
+			// request type (2 bytes), topic, partition (4 bytes) & message set size (4 bytes)
+			reader.skip(2);
+			reader.skip(reader.read<uint16_t>());
+			reader.skip(4);
+			const size_t end = reader.position() + reader.read<uint32_t>();
+
+			// each message is size (4 bytes), magic (1 byte), crc (4 bytes) & payload
+			while (!reader.failed() && reader.position() < end)
+			{
+				reader.skip(reader.read<uint32_t>());
+			}
+
+			// there is no response to carry an error, so a bad request ends the session instead
+			if (malformed(reader))
+			{
+				reject("malformed request");
+				return;
+			}
+
+			start();
+			return;
+		}
+
+		// request key & version (2 bytes each), correlation id (4 bytes), client id, acks (2 bytes), timeout (4 bytes)
+		reader.skip(4);
+		const uint32_t correlation_id = reader.read<uint32_t>();
+		reader.skip(reader.read<uint16_t>());
+		reader.skip(6);
+
+		// only a single topic and partition is ever sent by the producer
+		reader.skip(4);
+		const uint16_t topic_size = reader.read<uint16_t>();
+		const std::string topic(reader.failed() ? "" : std::string(reader.at(reader.position()), std::min<size_t>(topic_size, _request.size() - reader.position())));
+		reader.skip(topic_size);
+		reader.skip(4);
+		const uint32_t partition = reader.read<uint32_t>();
+		const size_t end = reader.position() + reader.read<uint32_t>();
+
+		// each message is offset (8 bytes), size (4 bytes), crc (4 bytes), magic & attributes (1 byte each), key & value
+		while (!reader.failed() && reader.position() < end)
+		{
+			reader.skip(8 + 4 + 4 + 2);
+			const int32_t key_size = reader.read<int32_t>();
+			if (key_size > 0) { reader.skip(key_size); }
+			reader.skip(reader.read<uint32_t>());
+		}
+
+		respond(correlation_id, topic, partition, malformed(reader) ? kafkaconnect::error::invalid_message : 0);
+		start();
+	}
+
+	// anything left over means the message set did not end where the request did
+	bool malformed(const request_reader& reader) const
+	{
+		return reader.failed() || reader.position() != _request.size();
+	}
+
+	void reject(const char* reason)
+	{
+		std::cerr << "mock broker: " << reason << ", closing the connection" << std::endl;
+
+		boost::system::error_code ignored;
+		_socket.close(ignored);
+	}
+
+	void respond(uint32_t correlation_id, const std::string& topic, uint32_t partition, int16_t error)
+	{
+		boost::asio::streambuf buffer;
+		std::ostream stream(&buffer);
+
+		write(stream, htonl(4 + 4 + 2 + topic.size() + 4 + 4 + 2 + 8));
+		write(stream, htonl(correlation_id));
+		write(stream, htonl(1));
+		write(stream, htons(topic.size()));
+		stream << topic;
+		write(stream, htonl(1));
+		write(stream, htonl(partition));
+		write(stream, htons(error));
+		write(stream, static_cast<uint64_t>(0));
+
+		// a blocking write keeps the mock simple, the producer always has a read outstanding
+		boost::system::error_code ignored;
+		boost::asio::write(_socket, buffer, ignored);
+	}
+
+	template <typename T>
+	static void write(std::ostream& stream, const T& value)
+	{
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+};
+
+class mock_broker
+{
+public:
+	mock_broker(boost::asio::io_service& io_service, bool acknowledged)
+		: _io_service(io_service)
+		, _acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+		, _acknowledged(acknowledged)
+	{
+		accept();
+	}
+
+	uint16_t port() const { return _acceptor.local_endpoint().port(); }
+
+private:
+	boost::asio::io_service& _io_service;
+	boost::asio::ip::tcp::acceptor _acceptor;
+	bool _acknowledged;
+
+	void accept()
+	{
+		boost::shared_ptr<mock_session> session(new mock_session(_io_service, _acknowledged));
+		_acceptor.async_accept(
+			session->socket(),
+			boost::bind(&mock_broker::handle_accept, this, session, boost::asio::placeholders::error)
+		);
+	}
+
+	void handle_accept(boost::shared_ptr<mock_session> session, const boost::system::error_code& error_code)
+	{
+		if (!error_code) { session->start(); }
+		accept();
+	}
+};
+
+struct options
+{
+	std::string hostname;
+	std::string port;
+	bool mock;
+	std::string topic;
+	uint32_t partitions;
+	size_t min_size;
+	size_t max_size;
+	size_t batch_size;
+	size_t threads;
+	size_t max_outstanding;
+	double rate;
+	double duration;
+	double interval;
+	int16_t acks;
+	uint32_t max_in_flight;
+	size_t encoder_threads;
+};
+
+/*
+ * Caps the sends a thread has waiting on its producer. The producer queues without limit, so without
+ * this a sender only measures how fast it can grow that queue rather than what actually gets through.
+ */
+class send_window
+{
+public:
+	send_window(size_t limit, statistics& stats) : _limit(limit), _outstanding(0), _flushed(false), _stats(stats) {}
+
+	// waits for room in the window, gives up once running is cleared
+	bool acquire(const boost::atomic<bool>& running)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		while (_outstanding >= _limit)
+		{
+			if (!running) { return false; }
+			_changed.timed_wait(lock, boost::posix_time::milliseconds(10));
+		}
+
+		++_outstanding;
+		return true;
+	}
+
+	void release()
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		--_outstanding;
+		_changed.notify_all();
+	}
+
+	// called from the io thread as each send completes, written or acked depending on the acks setting
+	void completed(const boost::system::error_code& error_code, int64_t stamp, size_t messages, size_t bytes)
+	{
+		if (error_code) { _stats.error(); }
+		else { _stats.completed(messages, bytes, static_cast<uint32_t>(std::max<int64_t>(now_micros() - stamp, 0))); }
+
+		release();
+	}
+
+	void flushed(const boost::system::error_code&)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_flushed = true;
+		_changed.notify_all();
+	}
+
+	bool wait_flushed(const boost::posix_time::time_duration& timeout)
+	{
+		const boost::system_time deadline = boost::get_system_time() + timeout;
+
+		boost::mutex::scoped_lock lock(_mutex);
+		while (!_flushed)
+		{
+			if (!_changed.timed_wait(lock, deadline)) { return _flushed; }
+		}
+		return true;
+	}
+
+private:
+	boost::mutex _mutex;
+	boost::condition_variable _changed;
+	const size_t _limit;
+	size_t _outstanding;
+	bool _flushed;
+	statistics& _stats;
+};
+
+void handle_error(const boost::system::error_code& error_code, statistics& stats)
+{
+	std::cerr << "producer error: " << error_code.message() << std::endl;
+	stats.error();
+}
+
+void run_sender(boost::asio::io_service& io_service, const options& opts, size_t thread, statistics& stats, boost::atomic<bool>& running)
+{
+	// outlives the producer, whose destructor waits out any completion still running against it
+	send_window window(opts.max_outstanding, stats);
+
+	kafkaconnect::producer producer(io_service, boost::bind(&handle_error, _1, boost::ref(stats)));
+	producer.require_acks(opts.acks, kafkaconnect::default_ack_timeout, opts.max_in_flight);
+	producer.set_encoder_threads(opts.encoder_threads);
+	producer.connect(opts.hostname, opts.port);
+
+	while(!producer.is_connected())
+	{
+		if (!running || !producer.is_connecting()) { return; }
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+
+	boost::random::mt19937 generator(thread);
+	boost::random::uniform_int_distribution<size_t> sizes(opts.min_size, opts.max_size);
+
+	// each thread paces its own share of the target rate
+	const double batch_interval = (opts.rate > 0) ? 1e6 * opts.batch_size * opts.threads / opts.rate : 0;
+	double next_batch = now_micros();
+
+	std::vector<std::string> batch(opts.batch_size);
+	uint32_t partition = thread % opts.partitions;
+
+	while (running && window.acquire(running))
+	{
+		size_t bytes = 0;
+		BOOST_FOREACH(std::string& message, batch)
+		{
+			message.assign(sizes(generator), 'x');
+			bytes += message.size();
+		}
+
+		const int64_t stamp = now_micros();
+		if (!producer.send(batch, opts.topic, partition, boost::bind(&send_window::completed, &window, _1, stamp, batch.size(), bytes)))
+		{
+			window.release();
+			break;
+		}
+
+		stats.sent(batch.size());
+		partition = (partition + 1) % opts.partitions;
+
+		if (batch_interval > 0)
+		{
+			next_batch += batch_interval;
+			const int64_t ahead = static_cast<int64_t>(next_batch) - now_micros();
+			if (ahead > 0) { boost::this_thread::sleep(boost::posix_time::microseconds(ahead)); }
+		}
+	}
+
+	// let everything sent complete before hanging up, a lost connection fails the rest so this returns
+	producer.flush(boost::bind(&send_window::flushed, &window, _1));
+	if (!window.wait_flushed(boost::posix_time::seconds(10)))
+	{
+		std::cerr << "producer flush timed out" << std::endl;
+	}
+
+	producer.close();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	namespace po = boost::program_options;
+
+	options opts;
+	int acks;
+	po::options_description description("kafkaconnect-perf options");
+	description.add_options()
+		("help", "show this message")
+		("host", po::value<std::string>(&opts.hostname)->default_value("localhost"), "broker hostname")
+		("port", po::value<std::string>(&opts.port)->default_value("9092"), "broker port")
+		("mock", po::bool_switch(&opts.mock), "run against an embedded mock broker and report latency")
+		("topic", po::value<std::string>(&opts.topic)->default_value("perf"), "topic to produce to")
+		("partitions", po::value<uint32_t>(&opts.partitions)->default_value(1), "partitions to spread batches over")
+		("min-size", po::value<size_t>(&opts.min_size)->default_value(100), "minimum message size in bytes")
+		("max-size", po::value<size_t>(&opts.max_size)->default_value(100), "maximum message size in bytes, sizes are uniform between min and max")
+		("batch-size", po::value<size_t>(&opts.batch_size)->default_value(1), "messages per send")
+		("threads", po::value<size_t>(&opts.threads)->default_value(1), "sending threads, each with its own producer")
+		("max-outstanding", po::value<size_t>(&opts.max_outstanding)->default_value(1000), "sends per thread waiting to complete before the thread blocks")
+		("rate", po::value<double>(&opts.rate)->default_value(0), "target messages per second across all threads, 0 for flat out")
+		("duration", po::value<double>(&opts.duration)->default_value(10), "seconds to run for")
+		("interval", po::value<double>(&opts.interval)->default_value(1), "seconds between reports")
+		("acks", po::value<int>(&acks)->default_value(0), "required acks, 0 for unacknowledged requests")
+		("max-in-flight", po::value<uint32_t>(&opts.max_in_flight)->default_value(kafkaconnect::default_max_in_flight), "unanswered requests per connection when acks are required")
+		("encoder-threads", po::value<size_t>(&opts.encoder_threads)->default_value(0), "encoder threads per producer, 0 to encode on the sending thread");
+
+	po::variables_map variables;
+	try
+	{
+		po::store(po::parse_command_line(argc, argv, description), variables);
+		po::notify(variables);
+	}
+	catch (const po::error& error)
+	{
+		std::cerr << error.what() << std::endl << description << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (variables.count("help"))
+	{
+		std::cout << description << std::endl;
+		return EXIT_SUCCESS;
+	}
+
+	opts.acks = acks;
+	opts.max_size = std::max(opts.max_size, opts.min_size);
+	opts.partitions = std::max<uint32_t>(opts.partitions, 1);
+	opts.batch_size = std::max<size_t>(opts.batch_size, 1);
+	opts.threads = std::max<size_t>(opts.threads, 1);
+	opts.max_outstanding = std::max<size_t>(opts.max_outstanding, 1);
+
+	statistics stats;
+
+	// the mock broker gets its own io thread so it does not compete with the producers
+	boost::asio::io_service mock_io_service;
+	boost::scoped_ptr<boost::asio::io_service::work> mock_work(new boost::asio::io_service::work(mock_io_service));
+	boost::scoped_ptr<mock_broker> broker;
+	if (opts.mock)
+	{
+		broker.reset(new mock_broker(mock_io_service, opts.acks != 0));
+		opts.hostname = "127.0.0.1";
+		opts.port = boost::lexical_cast<std::string>(broker->port());
+	}
+	boost::thread mock_thread(boost::bind(&boost::asio::io_service::run, &mock_io_service));
+
+	boost::asio::io_service io_service;
+	boost::scoped_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::thread io_thread(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	boost::atomic<bool> running(true);
+	boost::thread_group senders;
+	for (size_t thread = 0; thread < opts.threads; ++thread)
+	{
+		senders.create_thread(boost::bind(&run_sender, boost::ref(io_service), boost::cref(opts), thread, boost::ref(stats), boost::ref(running)));
+	}
+
+	statistics::header(std::cout);
+
+	int64_t started = now_micros();
+	int64_t last_report = started;
+	while (now_micros() - started < opts.duration * 1e6)
+	{
+		boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int64_t>(opts.interval * 1e6)));
+
+		const int64_t now = now_micros();
+		stats.report(std::cout, (now - started) / 1e6, (now - last_report) / 1e6);
+		last_report = now;
+	}
+
+	running = false;
+	senders.join_all();
+
+	// the totals include the senders' final flush
+	stats.summary(std::cout, (now_micros() - started) / 1e6);
+
+	work.reset();
+	io_service.stop();
+	io_thread.join();
+
+	mock_work.reset();
+	mock_io_service.stop();
+	mock_thread.join();
+
+	return EXIT_SUCCESS;
+}
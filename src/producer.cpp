@@ -21,8 +21,12 @@
  *      Author: Ben Gray (@benjamg)
  */
 
+#include <algorithm>
+
 #include <boost/lexical_cast.hpp>
 
+#include "decoder.hpp"
+#include "error.hpp"
 #include "producer.hpp"
 
 namespace kafkaconnect {
@@ -30,15 +34,33 @@ namespace kafkaconnect {
 producer::producer(boost::asio::io_service& io_service, const error_handler_function& error_handler)
 	: _connected(false)
 	, _connecting(false)
+	, _io_service(io_service)
 	, _resolver(io_service)
 	, _socket(io_service)
 	, _error_handler(error_handler)
+	, _lifetime(boost::make_shared<lifetime>())
+	, _required_acks(0)
+	, _ack_timeout(default_ack_timeout)
+	, _max_in_flight(default_max_in_flight)
+	, _correlation_id(0)
+	, _send_sequence(0)
+	, _write_sequence(0)
+	, _write_batch_pending(false)
+	, _completed_requests(0)
 {
 }
 
 producer::~producer()
 {
-	close();
+	// let the encoders finish first, what they post is skipped once we are marked dead below
+	_encoder_pool.reset();
+
+	boost::mutex::scoped_lock lock(_lifetime->mutex);
+	_lifetime->alive = false;
+
+	boost::system::error_code ignored;
+	_resolver.cancel();
+	_socket.close(ignored);
 }
 
 bool producer::connect(const std::string& hostname, const uint16_t port)
@@ -47,26 +69,36 @@ bool producer::connect(const std::string& hostname, const uint16_t port)
 }
 
 bool producer::connect(const std::string& hostname, const std::string& servicename)
+{
+	return connect(hostname, servicename, completion_handler_function());
+}
+
+bool producer::connect(const std::string& hostname, const std::string& servicename, const completion_handler_function& handler)
 {
 	if (_connecting) { return false; }
 	_connecting = true;
+	_connect_handler = handler;
 
 	boost::asio::ip::tcp::resolver::query query(hostname, servicename);
 	_resolver.async_resolve(
 		query,
-		boost::bind(
+		guard(boost::bind(
 			&producer::handle_resolve, this,
 			boost::asio::placeholders::error, boost::asio::placeholders::iterator
-		)
+		))
 	);
+
+	return true;
 }
 
 bool producer::close()
 {
 	if (_connecting) { return false; }
 
+	// the io thread owns the socket, anything already queued on it fails with operation_aborted
 	_connected = false;
-	_socket.close();
+	_io_service.post(guard(boost::bind(&producer::disconnect, this, boost::system::error_code(boost::asio::error::operation_aborted))));
+	return true;
 }
 
 bool producer::is_connected() const
@@ -79,6 +111,29 @@ bool producer::is_connecting() const
 	return _connecting;
 }
 
+void producer::flush(const completion_handler_function& handler)
+{
+	_io_service.post(guard(boost::bind(&producer::queue_flush, this, _send_sequence, handler)));
+}
+
+bool producer::require_acks(const int16_t required_acks, const int32_t timeout, const uint32_t max_in_flight)
+{
+	if (_connected || _connecting) { return false; }
+
+	_required_acks = required_acks;
+	_ack_timeout = timeout;
+	_max_in_flight = std::max<uint32_t>(max_in_flight, 1);
+	return true;
+}
+
+bool producer::set_encoder_threads(const size_t threads)
+{
+	if (_connected || _connecting) { return false; }
+
+	_encoder_pool.reset(threads == 0 ? NULL : new encoder_pool(threads));
+	return true;
+}
+
 void producer::handle_resolve(const boost::system::error_code& error_code, boost::asio::ip::tcp::resolver::iterator endpoints)
 {
 	if (!error_code)
@@ -86,16 +141,15 @@ void producer::handle_resolve(const boost::system::error_code& error_code, boost
 		boost::asio::ip::tcp::endpoint endpoint = *endpoints;
 		_socket.async_connect(
 			endpoint,
-			boost::bind(
+			guard(boost::bind(
 				&producer::handle_connect, this,
 				boost::asio::placeholders::error, ++endpoints
-			)
+			))
 		);
 	}
 	else
 	{
-		_connecting = false;
-		fail_fast_error_handler(error_code);
+		finish_connect(error_code);
 	}
 }
 
@@ -104,8 +158,14 @@ void producer::handle_connect(const boost::system::error_code& error_code, boost
 	if (!error_code)
 	{
 		// The connection was successful.
-		_connecting = false;
 		_connected = true;
+
+		if (_required_acks != 0)
+		{
+			read_response();
+		}
+
+		finish_connect(error_code);
 	}
 	else if (endpoints != boost::asio::ip::tcp::resolver::iterator())
 	{
@@ -117,19 +177,275 @@ void producer::handle_connect(const boost::system::error_code& error_code, boost
 	}
 	else
 	{
-		_connecting = false;
+		finish_connect(error_code);
+	}
+}
+
+void producer::finish_connect(const boost::system::error_code& error_code)
+{
+	_connecting = false;
+
+	completion_handler_function handler;
+	handler.swap(_connect_handler);
+
+	if (!handler.empty()) { defer(handler, error_code); }
+	else if (error_code) { fail_fast_error_handler(error_code); }
+}
+
+void producer::encode_copied_request(const uint64_t sequence, const uint32_t correlation_id, const int16_t required_acks, const int32_t ack_timeout, const std::string& topic, const uint32_t partition, boost::shared_ptr<const std::vector<std::string> > messages, const completion_handler_function& handler)
+{
+	encode_request(sequence, correlation_id, required_acks, ack_timeout, topic, partition, *messages, handler);
+}
+
+void producer::queue_write_request(const uint64_t sequence, const boost::shared_ptr<boost::asio::streambuf>& buffer, const uint32_t correlation_id, const completion_handler_function& handler)
+{
+	request encoded = { buffer, correlation_id, handler };
+
+	if (sequence != _write_sequence)
+	{
+		_reorder.insert(std::make_pair(sequence, encoded));
+		return;
+	}
+
+	_write_queue.push_back(encoded);
+	++_write_sequence;
+
+	// pull in anything that finished encoding ahead of this one
+	std::map<uint64_t, request>::iterator next;
+	while ((next = _reorder.begin()) != _reorder.end() && next->first == _write_sequence)
+	{
+		_write_queue.push_back(next->second);
+		_reorder.erase(next);
+		++_write_sequence;
+	}
+
+	if (!_connected)
+	{
+		// sent before the connection went down, there is nothing left to write it to
+		const boost::system::error_code error_code = boost::asio::error::not_connected;
+		const bool unhandled = fail_requests(_write_queue, error_code);
+		complete_flushes();
+
+		if (unhandled) { fail_fast_error_handler(error_code); }
+		return;
+	}
+
+	write_queued_requests();
+}
+
+void producer::write_queued_requests()
+{
+	if (!_connected || !_write_batch.empty() || _write_queue.empty())
+	{
+		return;
+	}
+
+	size_t count = _write_queue.size();
+	if (_required_acks != 0)
+	{
+		// Hold back anything beyond the in flight window until responses free it up
+		if (_in_flight.size() >= _max_in_flight) { return; }
+		count = std::min<size_t>(count, _max_in_flight - _in_flight.size());
+	}
+
+	_write_batch.assign(_write_queue.begin(), _write_queue.begin() + count);
+	_write_queue.erase(_write_queue.begin(), _write_queue.begin() + count);
+
+	// with acks required a successful write is only half way, the response completes it
+	_write_batch_pending = (_required_acks == 0);
+
+	_write_buffers.clear();
+	BOOST_FOREACH(const request& queued, _write_batch)
+	{
+		_write_buffers.push_back(queued.buffer->data());
+		if (_required_acks != 0)
+		{
+			request unanswered = { boost::shared_ptr<boost::asio::streambuf>(), queued.correlation_id, queued.completion };
+			_in_flight.push_back(unanswered);
+		}
+	}
+
+	boost::asio::async_write(
+		_socket, _write_buffers,
+		guard(boost::bind(&producer::handle_write_request, this, boost::asio::placeholders::error))
+	);
+}
+
+void producer::handle_write_request(const boost::system::error_code& error_code)
+{
+	bool unhandled = false;
+	if (!error_code)
+	{
+		if (_write_batch_pending)
+		{
+			BOOST_FOREACH(const request& written, _write_batch) { complete_request(written, error_code); }
+		}
+	}
+	else if (error_code != boost::asio::error::operation_aborted && _socket.is_open())
+	{
+		// the batch and everything behind it goes down with the connection
+		unhandled = disconnect(error_code);
+	}
+
+	// a cancelled write means the connection was torn down already, and the batch with it
+	_write_batch_pending = false;
+	_write_batch.clear();
+	complete_flushes();
+
+	if (unhandled)
+	{
 		fail_fast_error_handler(error_code);
 	}
+
+	write_queued_requests();
 }
 
-void producer::handle_write_request(const boost::system::error_code& error_code, boost::asio::streambuf* buffer)
+void producer::queue_flush(const uint64_t sequence, const completion_handler_function& handler)
 {
-	if (error_code)
+	_flushes.push_back(std::make_pair(sequence, handler));
+	complete_flushes();
+}
+
+bool producer::complete_request(const request& completed, const boost::system::error_code& error_code)
+{
+	++_completed_requests;
+
+	if (completed.completion.empty()) { return static_cast<bool>(error_code); }
+
+	defer(completed.completion, error_code);
+	return false;
+}
+
+void producer::complete_flushes()
+{
+	while (!_flushes.empty() && _flushes.front().first <= _completed_requests)
+	{
+		defer(_flushes.front().second, boost::system::error_code());
+		_flushes.pop_front();
+	}
+}
+
+bool producer::fail_requests(std::deque<request>& requests, const boost::system::error_code& error_code)
+{
+	bool unhandled = false;
+	while (!requests.empty())
+	{
+		const request failed = requests.front();
+		requests.pop_front();
+		unhandled = complete_request(failed, error_code) || unhandled;
+	}
+
+	return unhandled;
+}
+
+bool producer::disconnect(const boost::system::error_code& error_code)
+{
+	_connected = false;
+
+	// cancels the outstanding read and write, their handlers find the work below already done
+	boost::system::error_code ignored;
+	_socket.close(ignored);
+	_response.consume(_response.size());
+
+	// with nothing waiting on this connection only the error handler is left to hear about it
+	bool unhandled = !_write_batch_pending && _in_flight.empty() && _write_queue.empty();
+
+	if (_write_batch_pending)
+	{
+		// the buffers stay with the batch until the write handler runs
+		_write_batch_pending = false;
+		BOOST_FOREACH(const request& written, _write_batch)
+		{
+			unhandled = complete_request(written, error_code) || unhandled;
+		}
+	}
+
+	// in write order, so flushes never complete ahead of the requests they wait on
+	unhandled = fail_requests(_in_flight, error_code) || unhandled;
+	unhandled = fail_requests(_write_queue, error_code) || unhandled;
+	complete_flushes();
+
+	// closing the connection ourselves is not worth reporting
+	return unhandled && error_code != boost::asio::error::operation_aborted;
+}
+
+void producer::fail_connection(const boost::system::error_code& error_code)
+{
+	// a cancelled read is the connection already having been torn down
+	if (error_code == boost::asio::error::operation_aborted || !_socket.is_open()) { return; }
+
+	if (disconnect(error_code))
 	{
 		fail_fast_error_handler(error_code);
 	}
+}
 
-	delete buffer;
+void producer::read_response()
+{
+	boost::asio::async_read(
+		_socket, boost::asio::buffer(&_response_size, sizeof(_response_size)),
+		guard(boost::bind(&producer::handle_read_response_size, this, boost::asio::placeholders::error))
+	);
+}
+
+void producer::handle_read_response_size(const boost::system::error_code& error_code)
+{
+	if (error_code)
+	{
+		fail_connection(error_code);
+		return;
+	}
+
+	const uint32_t response_size = ntohl(_response_size);
+	if (response_size > max_response_size)
+	{
+		// not a produce response, whatever is on the other end is not speaking our protocol
+		fail_connection(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+		return;
+	}
+
+	boost::asio::async_read(
+		_socket, _response, boost::asio::transfer_exactly(response_size),
+		guard(boost::bind(&producer::handle_read_response, this, boost::asio::placeholders::error))
+	);
+}
+
+void producer::handle_read_response(const boost::system::error_code& error_code)
+{
+	if (error_code)
+	{
+		fail_connection(error_code);
+		return;
+	}
+
+	std::istream stream(&_response);
+	int32_t correlation_id;
+	int16_t response_error;
+	const bool decoded = decode_produce_response(stream, correlation_id, response_error);
+	_response.consume(_response.size());
+
+	if (!decoded || _in_flight.empty() || _in_flight.front().correlation_id != static_cast<uint32_t>(correlation_id))
+	{
+		// responses come back in write order, anything else means we have lost track of this connection
+		fail_connection(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+		return;
+	}
+
+	const request answered = _in_flight.front();
+	_in_flight.pop_front();
+
+	// carry on before reporting as the error handler is allowed to throw
+	write_queued_requests();
+	read_response();
+
+	const boost::system::error_code result = (response_error == 0) ? boost::system::error_code() : error::make_error_code(static_cast<error::kafka_errors>(response_error));
+	const bool unhandled = complete_request(answered, result);
+	complete_flushes();
+
+	if (unhandled)
+	{
+		fail_fast_error_handler(result);
+	}
 }
 
 }
@@ -24,25 +24,45 @@
 #ifndef KAFKA_PRODUCER_HPP_
 #define KAFKA_PRODUCER_HPP_
 
+#include <deque>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <stdint.h>
 
+#if __cplusplus >= 201402L
+#include "completion.hpp"
+#endif
 #include "encoder.hpp"
+#include "encoder_pool.hpp"
 
 namespace kafkaconnect {
 
 const uint32_t use_random_partition = 0xFFFFFFFF;
 
+const char* const default_client_id = "kafkaconnect";
+const int32_t default_ack_timeout = 1500;
+const uint32_t default_max_in_flight = 5;
+
+// A produce response for one topic and partition stays well under this even with the longest topic name
+const uint32_t max_response_size = 64 * 1024;
+
 class producer
 {
 public:
 	typedef boost::function<void(boost::system::error_code const&)> error_handler_function;
+	typedef boost::function<void(boost::system::error_code const&)> completion_handler_function;
 
 	producer(boost::asio::io_service& io_service, const error_handler_function& error_handler = error_handler_function());
 	~producer();
@@ -50,10 +70,33 @@ public:
 	bool connect(const std::string& hostname, const uint16_t port);
 	bool connect(const std::string& hostname, const std::string& servicename);
 
+	// As connect, but the outcome goes to the handler instead of the error handler
+	bool connect(const std::string& hostname, const std::string& servicename, const completion_handler_function& handler);
+
 	bool close();
 	bool is_connected() const;
 	bool is_connecting() const;
 
+	/*
+	 * Switch to acknowledged produce requests, the broker answers each one once required_acks replicas
+	 * have it (-1 for all in sync replicas) or timeout ms have passed. Up to max_in_flight requests are
+	 * written ahead of their responses, further sends queue until a response frees up the window.
+	 * Passing required_acks of 0 goes back to unacknowledged requests. Fails while connected.
+	 *
+	 * The ack level also picks the wire format. Acknowledged requests are versioned produce requests,
+	 * which name an exact partition, so send refuses use_random_partition while acks are required.
+	 * Unacknowledged requests use the legacy unversioned format, which a broker that only speaks the
+	 * versioned protocol will not accept, so such a broker can only be sent to with acks.
+	 */
+	bool require_acks(const int16_t required_acks, const int32_t timeout = kafkaconnect::default_ack_timeout, const uint32_t max_in_flight = kafkaconnect::default_max_in_flight);
+
+	/*
+	 * Move encoding and checksumming off the calling thread onto a pool of encoder threads, send then only
+	 * copies the messages. Requests still reach the socket in the order they were sent. Passing 0 threads
+	 * encodes on the calling thread again. Fails while connected.
+	 */
+	bool set_encoder_threads(const size_t threads);
+
 	bool send(std::string const& message, const std::string& topic, const uint32_t partition = kafkaconnect::use_random_partition)
 	{
 		boost::array<std::string, 1> messages = { { message } };
@@ -66,40 +109,342 @@ public:
 		return send(messages, topic, partition);
 	}
 
-	// TODO: replace this with a sending of the buffered data so encode is called prior to send this will allow for decoupling from the encoder
 	template <typename List>
 	bool send(const List& messages, const std::string& topic, const uint32_t partition = kafkaconnect::use_random_partition)
+	{
+		return send(messages, topic, partition, completion_handler_function());
+	}
+
+	/*
+	 * As send, but the handler is called from the io thread once the request has been written, or once
+	 * the broker has answered it when acks are required. Errors for this request go to the handler
+	 * instead of the error handler.
+	 */
+	template <typename List>
+	bool send(const List& messages, const std::string& topic, const uint32_t partition, const completion_handler_function& handler)
 	{
 		if (!is_connected())
 		{
 			return false;
 		}
 
-		// TODO: make this more efficient with memory allocations.
-		boost::asio::streambuf* buffer = new boost::asio::streambuf();
-		std::ostream stream(buffer);
+		// only the legacy request lets the broker pick, a versioned one would be answered with an unknown partition
+		if (_required_acks != 0 && partition == kafkaconnect::use_random_partition)
+		{
+			return false;
+		}
 
-		kafkaconnect::encode(stream, topic, partition, messages);
+		const uint64_t sequence = _send_sequence++;
 
-		boost::asio::async_write(
-			_socket, *buffer,
-			boost::bind(&producer::handle_write_request, this, boost::asio::placeholders::error, buffer)
-		);
+		// the encoders get the ack settings as they were at send, not whatever a later require_acks set
+		const int16_t required_acks = _required_acks;
+		const int32_t ack_timeout = _ack_timeout;
+		const uint32_t correlation_id = (required_acks == 0) ? 0 : ++_correlation_id;
+
+		if (_encoder_pool)
+		{
+			// the caller is free to reuse its messages once we return, so the workers get their own copy,
+			// the destructor joins the pool before anything the job touches goes away
+			boost::shared_ptr<const std::vector<std::string> > copy(new std::vector<std::string>(messages.begin(), messages.end()));
+			_encoder_pool->submit(boost::bind(&producer::encode_copied_request, this, sequence, correlation_id, required_acks, ack_timeout, topic, partition, copy, handler));
+		}
+		else
+		{
+			encode_request(sequence, correlation_id, required_acks, ack_timeout, topic, partition, messages, handler);
+		}
 
 		return true;
 	}
 
+	// Calls the handler from the io thread once every request sent before the flush has completed
+	void flush(const completion_handler_function& handler);
+
+#if __cplusplus >= 201402L
+	/*
+	 * Asio style versions of connect, send and flush taking any completion token, so with
+	 * boost::asio::use_awaitable they can be co_awaited from a coroutine on the producer's io_service.
+	 * Handlers are kept in recycled memory and resumed via post on their own executor, and asio recycles
+	 * the coroutine frames themselves, but a send still costs 3 heap allocations once warm: the request's
+	 * streambuf, its storage, and asio's copy of the gathered buffer list for the write (shared by every
+	 * request coalesced into it). An awaited flush averages under 0.1, from growing the flush queue.
+	 */
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+	async_connect(const std::string& hostname, const std::string& servicename, CompletionToken&& token)
+	{
+		return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+			[this](auto&& handler, const std::string& hostname, const std::string& servicename)
+			{
+				completion_handler_function completion = wrap_completion(std::move(handler));
+				if (!connect(hostname, servicename, completion)) { completion(boost::asio::error::already_started); }
+			},
+			token, hostname, servicename
+		);
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+	async_connect(const std::string& hostname, const uint16_t port, CompletionToken&& token)
+	{
+		return async_connect(hostname, boost::lexical_cast<std::string>(port), std::forward<CompletionToken>(token));
+	}
+
+	template <typename List, typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+	async_send(const List& messages, const std::string& topic, const uint32_t partition, CompletionToken&& token)
+	{
+		return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+			[this](auto&& handler, const List& messages, const std::string& topic, const uint32_t partition)
+			{
+				completion_handler_function completion = wrap_completion(std::move(handler));
+				if (!send(messages, topic, partition, completion))
+				{
+					const boost::system::error_code error_code = is_connected() ? boost::system::errc::make_error_code(boost::system::errc::invalid_argument) : boost::asio::error::not_connected;
+					completion(error_code);
+				}
+			},
+			token, messages, topic, partition
+		);
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+	async_send(std::string const& message, const std::string& topic, const uint32_t partition, CompletionToken&& token)
+	{
+		boost::array<std::string, 1> messages = { { message } };
+		return async_send(messages, topic, partition, std::forward<CompletionToken>(token));
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+	async_send(char const* message, const std::string& topic, const uint32_t partition, CompletionToken&& token)
+	{
+		boost::array<std::string, 1> messages = { { message } };
+		return async_send(messages, topic, partition, std::forward<CompletionToken>(token));
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code))
+	async_flush(CompletionToken&& token)
+	{
+		return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+			[this](auto&& handler) { flush(wrap_completion(std::move(handler))); },
+			token
+		);
+	}
+#endif
+
 
 private:
 	bool _connected;
 	bool _connecting;
+	boost::asio::io_service& _io_service;
 	boost::asio::ip::tcp::resolver _resolver;
 	boost::asio::ip::tcp::socket _socket;
 	error_handler_function _error_handler;
 
+	/* Lifetime Braindump
+	 *
+	 * Everything the producer posts to or starts on the io_service goes through guard(), which holds the
+	 * lifetime lock while the handler runs and skips it once the producer is gone. The destructor takes
+	 * the same lock, so it waits out a handler that is already running and anything still queued on the
+	 * io_service becomes a no op. Requests not yet written are dropped, flush first to avoid that.
+	 *
+	 * User callbacks, the error handler and the connect, send and flush completions, never run under the
+	 * lock. They are queued on the lifetime and run in order once the handler has let go of it, so any of
+	 * them may destroy the producer. A callback that does must not touch it afterwards, the remaining
+	 * callbacks still run as they only hold copies of the user's handlers.
+	 */
+	struct lifetime
+	{
+		lifetime() : alive(true) {}
+
+		struct callback
+		{
+			completion_handler_function function;
+			boost::system::error_code error_code;
+		};
+
+		boost::mutex mutex;
+		bool alive;
+		std::vector<callback> callbacks;
+
+		void run(std::vector<callback>& pending)
+		{
+			for (size_t i = 0; i < pending.size(); ++i)
+			{
+				// an empty function is the error handler nobody provided, see the fail fast braindump
+				if (pending[i].function.empty()) { throw boost::system::system_error(pending[i].error_code); }
+				pending[i].function(pending[i].error_code);
+			}
+
+			// hand the capacity back so the next handler does not have to allocate
+			pending.clear();
+			boost::mutex::scoped_lock lock(mutex);
+			if (callbacks.empty()) { callbacks.swap(pending); }
+		}
+	};
+
+	template <typename Function>
+	class guarded_handler
+	{
+	public:
+		guarded_handler(const boost::shared_ptr<lifetime>& lifetime, const Function& function) : _lifetime(lifetime), _function(function) {}
+
+		void operator()()
+		{
+			std::vector<typename lifetime::callback> pending;
+			{
+				boost::mutex::scoped_lock lock(_lifetime->mutex);
+				if (!_lifetime->alive) { return; }
+				_function();
+				pending.swap(_lifetime->callbacks);
+			}
+
+			_lifetime->run(pending);
+		}
+
+		template <typename Arg1>
+		void operator()(const Arg1& arg1)
+		{
+			std::vector<typename lifetime::callback> pending;
+			{
+				boost::mutex::scoped_lock lock(_lifetime->mutex);
+				if (!_lifetime->alive) { return; }
+				_function(arg1);
+				pending.swap(_lifetime->callbacks);
+			}
+
+			_lifetime->run(pending);
+		}
+
+		template <typename Arg1, typename Arg2>
+		void operator()(const Arg1& arg1, const Arg2& arg2)
+		{
+			std::vector<typename lifetime::callback> pending;
+			{
+				boost::mutex::scoped_lock lock(_lifetime->mutex);
+				if (!_lifetime->alive) { return; }
+				_function(arg1, arg2);
+				pending.swap(_lifetime->callbacks);
+			}
+
+			_lifetime->run(pending);
+		}
+
+	private:
+		boost::shared_ptr<lifetime> _lifetime;
+		Function _function;
+	};
+
+	boost::shared_ptr<lifetime> _lifetime;
+
+	template <typename Function>
+	guarded_handler<Function> guard(const Function& function)
+	{
+		return guarded_handler<Function>(_lifetime, function);
+	}
+
+	struct request
+	{
+		boost::shared_ptr<boost::asio::streambuf> buffer;
+		uint32_t correlation_id;
+		completion_handler_function completion;
+	};
+
+	completion_handler_function _connect_handler;
+
+	int16_t _required_acks;
+	int32_t _ack_timeout;
+	uint32_t _max_in_flight;
+
+	// unsigned so that it wraps around rather than overflowing, the wire carries the same bits as an int32
+	uint32_t _correlation_id;
+
+	boost::scoped_ptr<encoder_pool> _encoder_pool;
+	uint64_t _send_sequence;
+
+	/* Write Coalescing Braindump
+	 *
+	 * Only one write is ever outstanding on the socket. Requests that arrive while it is in flight wait
+	 * in the queue and are then written together as a single gathered write, so under load many
+	 * requests share one syscall and one completion instead of paying for each. This also stops
+	 * concurrent async_writes from interleaving their bytes on the wire.
+	 *
+	 * With acks required the broker answers requests in the order they were written, so the correlation
+	 * ids of written but unanswered requests are kept in order and each response must match the oldest.
+	 *
+	 * A request completes once written, or once answered when acks are required, which in both cases is
+	 * in send order, so a count of completed requests is enough to know when a flush is done.
+	 *
+	 * Requests encoded on the encoder pool can finish out of order, so each carries the sequence number
+	 * it was sent with and anything that arrives early waits in the reorder map until its turn.
+	 *
+	 * A read or write failure, or close, tears the whole connection down. The socket is closed and the
+	 * in flight batch, the unanswered requests and the queue all fail with the error, requests still
+	 * making their way to the io thread fail with not_connected as they arrive, so every handler and
+	 * flush hears back and send returns false until the next connect.
+	 *
+	 * The queue, the reorder map, the in flight batch and the unanswered requests are only touched from
+	 * the io thread.
+	 */
+	uint64_t _write_sequence;
+	std::map<uint64_t, request> _reorder;
+	std::deque<request> _write_queue;
+	std::vector<request> _write_batch;
+	bool _write_batch_pending;
+	std::vector<boost::asio::const_buffer> _write_buffers;
+	std::deque<request> _in_flight;
+	uint64_t _completed_requests;
+	std::deque<std::pair<uint64_t, completion_handler_function> > _flushes;
+	uint32_t _response_size;
+	boost::asio::streambuf _response;
+
 	void handle_resolve(const boost::system::error_code& error_code, boost::asio::ip::tcp::resolver::iterator endpoints);
 	void handle_connect(const boost::system::error_code& error_code, boost::asio::ip::tcp::resolver::iterator endpoints);
-	void handle_write_request(const boost::system::error_code& error_code, boost::asio::streambuf* buffer);
+#if __cplusplus >= 201402L
+	template <typename Handler>
+	completion_handler_function wrap_completion(Handler&& handler)
+	{
+		typedef typename std::decay<Handler>::type handler_type;
+		return detail::shared_completion<handler_type, boost::asio::io_service::executor_type>(std::move(handler), _io_service.get_executor());
+	}
+#endif
+
+	template <typename List>
+	void encode_request(const uint64_t sequence, const uint32_t correlation_id, const int16_t required_acks, const int32_t ack_timeout, const std::string& topic, const uint32_t partition, const List& messages, const completion_handler_function& handler)
+	{
+		// TODO: make this more efficient with memory allocations.
+		boost::shared_ptr<boost::asio::streambuf> buffer = boost::make_shared<boost::asio::streambuf>();
+		std::ostream stream(buffer.get());
+
+		if (required_acks == 0)
+		{
+			kafkaconnect::encode(stream, topic, partition, messages);
+		}
+		else
+		{
+			kafkaconnect::encode(stream, static_cast<int32_t>(correlation_id), default_client_id, required_acks, ack_timeout, topic, partition, messages);
+		}
+
+		// hand the encoded request to the io thread, it owns the socket and the write queue
+		_io_service.post(guard(boost::bind(&producer::queue_write_request, this, sequence, buffer, correlation_id, handler)));
+	}
+
+	void encode_copied_request(const uint64_t sequence, const uint32_t correlation_id, const int16_t required_acks, const int32_t ack_timeout, const std::string& topic, const uint32_t partition, boost::shared_ptr<const std::vector<std::string> > messages, const completion_handler_function& handler);
+	void queue_write_request(const uint64_t sequence, const boost::shared_ptr<boost::asio::streambuf>& buffer, const uint32_t correlation_id, const completion_handler_function& handler);
+	void queue_flush(const uint64_t sequence, const completion_handler_function& handler);
+	void finish_connect(const boost::system::error_code& error_code);
+	bool complete_request(const request& completed, const boost::system::error_code& error_code);
+	void complete_flushes();
+	bool fail_requests(std::deque<request>& requests, const boost::system::error_code& error_code);
+	bool disconnect(const boost::system::error_code& error_code);
+	void fail_connection(const boost::system::error_code& error_code);
+	void write_queued_requests();
+	void handle_write_request(const boost::system::error_code& error_code);
+	void read_response();
+	void handle_read_response_size(const boost::system::error_code& error_code);
+	void handle_read_response(const boost::system::error_code& error_code);
 
 	/* Fail Fast Error Handler Braindump
 	 *
@@ -113,8 +458,14 @@ private:
 	 */
 	inline void fail_fast_error_handler(const boost::system::error_code& error_code)
 	{
-		if(_error_handler.empty()) { throw boost::system::system_error(error_code); }
-		else { _error_handler(error_code); }
+		defer(_error_handler, error_code);
+	}
+
+	// Queues a user callback to run once the current io handler has released the lifetime lock
+	inline void defer(const completion_handler_function& function, const boost::system::error_code& error_code)
+	{
+		const lifetime::callback deferred = { function, error_code };
+		_lifetime->callbacks.push_back(deferred);
 	}
 };
 
@@ -0,0 +1,90 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/*
+ * decoder_tests.cpp
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE kafkaconnect
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "../decoder.hpp"
+#include "../encoder_helper.hpp"
+
+// test wrapper
+namespace kafkaconnect { namespace test {
+class encoder_helper {
+public:
+	template <typename T> static std::ostream& raw(std::ostream& stream, const T& t) { return kafkaconnect::encoder_helper::raw(stream, t); }
+};
+} }
+
+using namespace kafkaconnect::test;
+
+std::string produce_response(const int32_t correlation_id, const uint32_t partitions, const int16_t error)
+{
+	std::ostringstream stream;
+	encoder_helper::raw(stream, htonl(correlation_id));
+	encoder_helper::raw(stream, htonl(1));
+	encoder_helper::raw(stream, htons(strlen("topic")));
+	stream << "topic";
+	encoder_helper::raw(stream, htonl(partitions));
+	for(uint32_t partition = 0; partition < partitions; ++partition)
+	{
+		encoder_helper::raw(stream, htonl(partition));
+		encoder_helper::raw(stream, htons(partition + 1 == partitions ? error : 0));
+		encoder_helper::raw(stream, static_cast<uint64_t>(0));
+	}
+	return stream.str();
+}
+
+BOOST_AUTO_TEST_CASE(produce_response_test)
+{
+	std::istringstream stream(produce_response(42, 1, 0));
+
+	int32_t correlation_id;
+	int16_t error;
+	BOOST_CHECK(kafkaconnect::decode_produce_response(stream, correlation_id, error));
+	BOOST_CHECK_EQUAL(correlation_id, 42);
+	BOOST_CHECK_EQUAL(error, 0);
+}
+
+BOOST_AUTO_TEST_CASE(produce_response_error_test)
+{
+	std::istringstream stream(produce_response(7, 3, 6));
+
+	int32_t correlation_id;
+	int16_t error;
+	BOOST_CHECK(kafkaconnect::decode_produce_response(stream, correlation_id, error));
+	BOOST_CHECK_EQUAL(correlation_id, 7);
+	BOOST_CHECK_EQUAL(error, 6);
+}
+
+BOOST_AUTO_TEST_CASE(truncated_produce_response_test)
+{
+	std::string response = produce_response(7, 2, 0);
+	std::istringstream stream(response.substr(0, response.length() - 1));
+
+	int32_t correlation_id;
+	int16_t error;
+	BOOST_CHECK(!kafkaconnect::decode_produce_response(stream, correlation_id, error));
+}
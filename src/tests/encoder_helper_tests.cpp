@@ -35,6 +35,7 @@ namespace kafkaconnect { namespace test {
 class encoder_helper {
 public:
 	static std::ostream& message(std::ostream& stream, const std::string message) { return kafkaconnect::encoder_helper::message(stream, message); }
+	static std::ostream& versioned_message(std::ostream& stream, const std::string message) { return kafkaconnect::encoder_helper::versioned_message(stream, message); }
 	template <typename T> static std::ostream& raw(std::ostream& stream, const T& t) { return kafkaconnect::encoder_helper::raw(stream, t); }
 };
 } }
@@ -85,4 +86,26 @@ BOOST_AUTO_TEST_CASE(encode_message)
 	}
 }
 
+BOOST_AUTO_TEST_CASE(encode_versioned_message)
+{
+	std::string message = "a simple test";
+	std::ostringstream stream;
+
+	encoder_helper::versioned_message(stream, message);
+
+	BOOST_CHECK_EQUAL(stream.str().length(), kafkaconnect::versioned_message_format_header_size + message.length());
+	BOOST_CHECK_EQUAL(stream.str().at(7), 0);
+	BOOST_CHECK_EQUAL(stream.str().at(11), 14 + message.length());
+	BOOST_CHECK_EQUAL(stream.str().at(16), kafkaconnect::message_format_magic_number);
+	BOOST_CHECK_EQUAL(stream.str().at(17), 0);
+	BOOST_CHECK_EQUAL(stream.str().at(18), -1);
+	BOOST_CHECK_EQUAL(stream.str().at(21), -1);
+	BOOST_CHECK_EQUAL(stream.str().at(25), message.length());
+
+	for(size_t i = 0; i < message.length(); ++i)
+	{
+		BOOST_CHECK_EQUAL(stream.str().at(26 + i), message.at(i));
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
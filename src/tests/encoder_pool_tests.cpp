@@ -0,0 +1,78 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/*
+ * encoder_pool_tests.cpp
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE kafkaconnect
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "../encoder_pool.hpp"
+
+void count_job(boost::mutex& mutex, int& count)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	++count;
+}
+
+void record_thread_job(boost::mutex& mutex, std::set<boost::thread::id>& threads)
+{
+	boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+
+	boost::mutex::scoped_lock lock(mutex);
+	threads.insert(boost::this_thread::get_id());
+}
+
+BOOST_AUTO_TEST_CASE(runs_all_jobs_before_destruction)
+{
+	boost::mutex mutex;
+	int count = 0;
+
+	{
+		kafkaconnect::encoder_pool pool(4);
+		for (int i = 0; i < 1000; ++i)
+		{
+			pool.submit(boost::bind(&count_job, boost::ref(mutex), boost::ref(count)));
+		}
+	}
+
+	BOOST_CHECK_EQUAL(count, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(spreads_jobs_across_threads)
+{
+	boost::mutex mutex;
+	std::set<boost::thread::id> threads;
+
+	{
+		kafkaconnect::encoder_pool pool(4);
+		for (int i = 0; i < 16; ++i)
+		{
+			pool.submit(boost::bind(&record_thread_job, boost::ref(mutex), boost::ref(threads)));
+		}
+	}
+
+	BOOST_CHECK_GT(threads.size(), 1);
+	BOOST_CHECK(threads.find(boost::this_thread::get_id()) == threads.end());
+}
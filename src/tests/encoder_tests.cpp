@@ -67,3 +67,31 @@ BOOST_AUTO_TEST_CASE(multiple_message_test)
 	BOOST_CHECK_EQUAL(stream.str().at(15 + strlen("topic")), 9 + strlen("test message") + 9 + strlen("another message to check"));
 }
 
+
+BOOST_AUTO_TEST_CASE(acknowledged_message_test)
+{
+	std::ostringstream stream;
+
+	std::vector<std::string> messages;
+	messages.push_back("test message");
+
+	kafkaconnect::encode(stream, 7, "kc", -1, 1000, "topic", 1, messages);
+
+	const size_t header_size = 4 + 2 + 2 + 4 + 2 + strlen("kc") + 2 + 4 + 4 + 2 + strlen("topic") + 4 + 4 + 4;
+	BOOST_CHECK_EQUAL(stream.str().length(), header_size + 26 + strlen("test message"));
+	BOOST_CHECK_EQUAL(stream.str().at(3), header_size - 4 + 26 + strlen("test message"));
+	BOOST_CHECK_EQUAL(stream.str().at(5), kafkaconnect::produce_request_key);
+	BOOST_CHECK_EQUAL(stream.str().at(7), kafkaconnect::produce_request_version);
+	BOOST_CHECK_EQUAL(stream.str().at(11), 7);
+	BOOST_CHECK_EQUAL(stream.str().at(13), strlen("kc"));
+	BOOST_CHECK_EQUAL(stream.str().at(14), 'k');
+	BOOST_CHECK_EQUAL(stream.str().at(16), -1);
+	BOOST_CHECK_EQUAL(stream.str().at(17), -1);
+	BOOST_CHECK_EQUAL(stream.str().at(25), 1);
+	BOOST_CHECK_EQUAL(stream.str().at(27), strlen("topic"));
+	BOOST_CHECK_EQUAL(stream.str().at(28), 't');
+	BOOST_CHECK_EQUAL(stream.str().at(36), 1);
+	BOOST_CHECK_EQUAL(stream.str().at(40), 1);
+	BOOST_CHECK_EQUAL(stream.str().at(44), 26 + strlen("test message"));
+	BOOST_CHECK_EQUAL(stream.str().at(header_size + 26), 't');
+}
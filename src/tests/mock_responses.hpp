@@ -0,0 +1,55 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/*
+ * mock_responses.hpp
+ */
+
+#ifndef KAFKA_TESTS_MOCK_RESPONSES_HPP_
+#define KAFKA_TESTS_MOCK_RESPONSES_HPP_
+
+#include <cstring>
+#include <ostream>
+
+#include <boost/asio.hpp>
+#include <stdint.h>
+
+// Plays the broker, answering a produce request for partition 0 of "mice"
+inline void write_produce_response(boost::asio::ip::tcp::socket& socket, const int32_t correlation_id, const int16_t error)
+{
+	boost::asio::streambuf buffer;
+	std::ostream stream(&buffer);
+	const uint32_t size = htonl(4 + 4 + 2 + strlen("mice") + 4 + 4 + 2 + 8);
+	const int32_t id = htonl(correlation_id);
+	const uint32_t one = htonl(1);
+	const uint16_t topic_size = htons(strlen("mice"));
+	const uint32_t partition = htonl(0);
+	const int16_t code = htons(error);
+	const uint64_t offset = 0;
+	stream.write(reinterpret_cast<const char*>(&size), 4);
+	stream.write(reinterpret_cast<const char*>(&id), 4);
+	stream.write(reinterpret_cast<const char*>(&one), 4);
+	stream.write(reinterpret_cast<const char*>(&topic_size), 2);
+	stream << "mice";
+	stream.write(reinterpret_cast<const char*>(&one), 4);
+	stream.write(reinterpret_cast<const char*>(&partition), 4);
+	stream.write(reinterpret_cast<const char*>(&code), 2);
+	stream.write(reinterpret_cast<const char*>(&offset), 8);
+	boost::asio::write(socket, buffer);
+}
+
+#endif /* KAFKA_TESTS_MOCK_RESPONSES_HPP_ */
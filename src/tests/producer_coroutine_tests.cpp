@@ -0,0 +1,99 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/*
+ * producer_coroutine_tests.cpp
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE kafkaconnect
+#include <boost/test/unit_test.hpp>
+
+#include <utility>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/thread.hpp>
+
+#include "../producer.hpp"
+#include "mock_responses.hpp"
+
+using boost::asio::use_awaitable;
+
+boost::asio::awaitable<void> produce(kafkaconnect::producer& producer, std::vector<std::string>& results, boost::promise<void>& done)
+{
+	boost::system::error_code error;
+
+	co_await producer.async_send("too early", "mice", 0, boost::asio::redirect_error(use_awaitable, error));
+	results.push_back("early:" + error.message());
+
+	co_await producer.async_connect("localhost", 12345, use_awaitable);
+	results.push_back(producer.is_connected() ? "connected" : "not connected");
+
+	co_await producer.async_send("so long", "mice", 0, use_awaitable);
+	results.push_back("sent");
+
+	co_await producer.async_send("and thanks", "mice", 0, boost::asio::redirect_error(use_awaitable, error));
+	results.push_back("rejected:" + error.message());
+
+	producer.send("for all the fish", "mice", 0);
+	co_await producer.async_flush(use_awaitable);
+	results.push_back("flushed");
+
+	done.set_value();
+}
+
+BOOST_AUTO_TEST_CASE( awaitable_producer_test )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	kafkaconnect::producer producer(io_service);
+	producer.require_acks(1);
+
+	std::vector<std::string> results;
+	boost::promise<void> done;
+	boost::asio::co_spawn(io_service, produce(producer, results, done), boost::asio::detached);
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	// answer each request as it arrives, the second one with an error
+	boost::array<char, 1024> buffer;
+	for(int32_t correlation_id = 1; correlation_id <= 3; ++correlation_id)
+	{
+		uint32_t size;
+		boost::asio::read(socket, boost::asio::buffer(&size, sizeof(size)));
+		boost::asio::read(socket, boost::asio::buffer(buffer.data(), ntohl(size)));
+		write_produce_response(socket, correlation_id, correlation_id == 2 ? 3 : 0);
+	}
+
+	BOOST_REQUIRE(done.get_future().timed_wait(boost::posix_time::seconds(5)));
+	BOOST_REQUIRE_EQUAL(results.size(), 5);
+	BOOST_CHECK_EQUAL(results[0], "early:" + boost::system::error_code(boost::asio::error::not_connected).message());
+	BOOST_CHECK_EQUAL(results[1], "connected");
+	BOOST_CHECK_EQUAL(results[2], "sent");
+	BOOST_CHECK_EQUAL(results[3], "rejected:Unknown topic or partition");
+	BOOST_CHECK_EQUAL(results[4], "flushed");
+
+	work.reset();
+	io_service.stop();
+}
@@ -11,7 +11,9 @@
 
 #include <boost/thread.hpp>
 
+#include "../error.hpp"
 #include "../producer.hpp"
+#include "mock_responses.hpp"
 
 void handle_error(boost::system::error_code const& error, int expected_error, std::string const& expected_message, bool& called)
 {
@@ -40,6 +42,106 @@ BOOST_AUTO_TEST_CASE( invalid_target )
 	io_service.stop();
 }
 
+BOOST_AUTO_TEST_CASE( acknowledged_error )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	bool called = false;
+	kafkaconnect::producer producer(io_service, boost::bind(&handle_error, _1, kafkaconnect::error::unknown_topic_or_partition, "Unknown topic or partition", boost::ref(called)));
+	producer.require_acks(1);
+	producer.connect("localhost", 12345);
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	while(!producer.is_connected())
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+
+	producer.send("message", "mice", 0);
+
+	boost::array<char, 1024> buffer;
+	socket.read_some(boost::asio::buffer(buffer));
+
+	write_produce_response(socket, 1, kafkaconnect::error::unknown_topic_or_partition);
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+	BOOST_CHECK(called);
+
+	work.reset();
+	io_service.stop();
+}
+
+BOOST_AUTO_TEST_CASE( oversized_response )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	bool called = false;
+	kafkaconnect::producer producer(io_service, boost::bind(&handle_error, _1, boost::system::errc::protocol_error, "Protocol error", boost::ref(called)));
+	producer.require_acks(1);
+	producer.connect("localhost", 12345);
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	while(!producer.is_connected())
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+
+	producer.send("message", "mice", 0);
+
+	boost::array<char, 1024> buffer;
+	socket.read_some(boost::asio::buffer(buffer));
+
+	const uint32_t size = htonl(kafkaconnect::max_response_size + 1);
+	boost::asio::write(socket, boost::asio::buffer(&size, sizeof(size)));
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+	BOOST_CHECK(called);
+	BOOST_CHECK_EQUAL(producer.is_connected(), false);
+
+	work.reset();
+	io_service.stop();
+}
+
+BOOST_AUTO_TEST_CASE( acknowledged_random_partition )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	kafkaconnect::producer producer(io_service);
+	producer.require_acks(1);
+	producer.connect("localhost", 12345);
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	while(!producer.is_connected())
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+
+	// a versioned request cannot leave the partition to the broker
+	BOOST_CHECK_EQUAL(producer.send("message", "mice"), false);
+	BOOST_CHECK_EQUAL(producer.send("message", "mice", kafkaconnect::use_random_partition), false);
+	BOOST_CHECK_EQUAL(producer.is_connected(), true);
+
+	BOOST_CHECK_EQUAL(producer.send("message", "mice", 0), true);
+
+	work.reset();
+	io_service.stop();
+}
+
 /* TODO: work out why this test doesn't call the exception handler
 BOOST_AUTO_TEST_CASE( target_lost )
 {
@@ -29,6 +29,7 @@
 #include <boost/thread.hpp>
 
 #include "../producer.hpp"
+#include "mock_responses.hpp"
 
 void handle_error(boost::system::error_code const& error, int expected_error, std::string const& expected_message)
 {
@@ -36,6 +37,20 @@ void handle_error(boost::system::error_code const& error, int expected_error, st
 	BOOST_CHECK_EQUAL(expected_message, error.message());
 }
 
+void destroy_producer(boost::system::error_code const& error, kafkaconnect::producer*& producer, bool& destroyed)
+{
+	BOOST_CHECK(!error);
+	delete producer;
+	producer = NULL;
+	destroyed = true;
+}
+
+void record_result(boost::system::error_code const& error, std::vector<std::string>& results, std::string const& name, boost::mutex& mutex)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	results.push_back(name + (error ? ":" + error.message() : ""));
+}
+
 BOOST_AUTO_TEST_CASE( basic_message_test )
 {
 	boost::asio::io_service io_service;
@@ -81,3 +96,260 @@ BOOST_AUTO_TEST_CASE( basic_message_test )
 	work.reset();
 	io_service.stop();
 }
+
+BOOST_AUTO_TEST_CASE( queued_messages_test )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	kafkaconnect::producer producer(io_service);
+	producer.connect("localhost", 12345);
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	while(!producer.is_connected())
+	{
+		boost::this_thread::sleep(boost::posix_time::seconds(1));
+	}
+
+	const size_t request_size = 4 + 2 + 2 + strlen("mice") + 4 + 4 + 9 + strlen("42");
+	for(uint32_t partition = 0; partition < 10; ++partition)
+	{
+		BOOST_CHECK(producer.send("42", "mice", partition));
+	}
+
+	boost::array<char, 10 * request_size> buffer;
+	boost::system::error_code error;
+	size_t len = boost::asio::read(socket, boost::asio::buffer(buffer), error);
+
+	BOOST_CHECK_EQUAL(len, 10 * request_size);
+	for(size_t i = 0; i < 10; ++i)
+	{
+		BOOST_CHECK_EQUAL(buffer[i * request_size + 3], request_size - 4);
+		BOOST_CHECK_EQUAL(buffer[i * request_size + 11 + strlen("mice")], i);
+	}
+
+	work.reset();
+	io_service.stop();
+}
+
+BOOST_AUTO_TEST_CASE( acknowledged_window_test )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	kafkaconnect::producer producer(io_service);
+	BOOST_CHECK(producer.require_acks(1, 1000, 2));
+	producer.connect("localhost", 12345);
+	BOOST_CHECK(!producer.require_acks(1, 1000, 2));
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	while(!producer.is_connected())
+	{
+		boost::this_thread::sleep(boost::posix_time::seconds(1));
+	}
+
+	const size_t request_size = 4 + 2 + 2 + 4 + 2 + strlen(kafkaconnect::default_client_id) + 2 + 4 + 4 + 2 + strlen("mice") + 4 + 4 + 4 + 26 + strlen("42");
+	for(int i = 0; i < 3; ++i)
+	{
+		BOOST_CHECK(producer.send("42", "mice", 0));
+	}
+
+	// only the window of two requests is written ahead of any response
+	boost::array<char, 3 * request_size> buffer;
+	size_t len = boost::asio::read(socket, boost::asio::buffer(buffer.data(), 2 * request_size));
+	BOOST_CHECK_EQUAL(len, 2 * request_size);
+	BOOST_CHECK_EQUAL(buffer[11], 1);
+	BOOST_CHECK_EQUAL(buffer[request_size + 11], 2);
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+	BOOST_CHECK_EQUAL(socket.available(), 0);
+
+	// answering the first lets the third through
+	write_produce_response(socket, 1, 0);
+	len = boost::asio::read(socket, boost::asio::buffer(buffer.data() + 2 * request_size, request_size));
+	BOOST_CHECK_EQUAL(len, request_size);
+	BOOST_CHECK_EQUAL(buffer[2 * request_size + 11], 3);
+
+	work.reset();
+	io_service.stop();
+}
+
+BOOST_AUTO_TEST_CASE( encoder_threads_keep_order_test )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	kafkaconnect::producer producer(io_service);
+	BOOST_CHECK(producer.set_encoder_threads(4));
+	producer.connect("localhost", 12345);
+	BOOST_CHECK(!producer.set_encoder_threads(2));
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	while(!producer.is_connected())
+	{
+		boost::this_thread::sleep(boost::posix_time::seconds(1));
+	}
+
+	const size_t request_size = 4 + 2 + 2 + strlen("mice") + 4 + 4 + 9 + strlen("42");
+	for(uint32_t partition = 0; partition < 100; ++partition)
+	{
+		BOOST_CHECK(producer.send("42", "mice", partition));
+	}
+
+	boost::array<char, 100 * request_size> buffer;
+	size_t len = boost::asio::read(socket, boost::asio::buffer(buffer));
+
+	BOOST_CHECK_EQUAL(len, 100 * request_size);
+	for(size_t i = 0; i < 100; ++i)
+	{
+		BOOST_CHECK_EQUAL(buffer[i * request_size + 11 + strlen("mice")], i);
+	}
+
+	work.reset();
+	io_service.stop();
+}
+
+BOOST_AUTO_TEST_CASE( completion_handlers_test )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	boost::mutex mutex;
+	std::vector<std::string> results;
+
+	kafkaconnect::producer producer(io_service);
+	producer.require_acks(1);
+	producer.connect("localhost", "12345", boost::bind(&record_result, _1, boost::ref(results), "connect", boost::ref(mutex)));
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	while(!producer.is_connected())
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+
+	boost::array<std::string, 1> messages = { { "42" } };
+	producer.send(messages, "mice", 0, boost::bind(&record_result, _1, boost::ref(results), "first", boost::ref(mutex)));
+	producer.send(messages, "mice", 0, boost::bind(&record_result, _1, boost::ref(results), "second", boost::ref(mutex)));
+	producer.flush(boost::bind(&record_result, _1, boost::ref(results), "flush", boost::ref(mutex)));
+
+	boost::array<char, 1024> buffer;
+	const size_t request_size = 4 + 2 + 2 + 4 + 2 + strlen(kafkaconnect::default_client_id) + 2 + 4 + 4 + 2 + strlen("mice") + 4 + 4 + 4 + 26 + strlen("42");
+	boost::asio::read(socket, boost::asio::buffer(buffer.data(), 2 * request_size));
+
+	write_produce_response(socket, 1, 0);
+	write_produce_response(socket, 2, 5);
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+	boost::mutex::scoped_lock lock(mutex);
+	BOOST_REQUIRE_EQUAL(results.size(), 4);
+	BOOST_CHECK_EQUAL(results[0], "connect");
+	BOOST_CHECK_EQUAL(results[1], "first");
+	BOOST_CHECK_EQUAL(results[2], "second:Leader not available");
+	BOOST_CHECK_EQUAL(results[3], "flush");
+
+	work.reset();
+	io_service.stop();
+}
+
+BOOST_AUTO_TEST_CASE( connection_lost_test )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	boost::mutex mutex;
+	std::vector<std::string> results;
+
+	kafkaconnect::producer producer(io_service);
+	producer.require_acks(1);
+	producer.connect("localhost", 12345);
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	while(!producer.is_connected())
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+
+	boost::array<std::string, 1> messages = { { "42" } };
+	producer.send(messages, "mice", 0, boost::bind(&record_result, _1, boost::ref(results), "first", boost::ref(mutex)));
+	producer.send(messages, "mice", 0, boost::bind(&record_result, _1, boost::ref(results), "second", boost::ref(mutex)));
+	producer.send(messages, "mice", 0, boost::bind(&record_result, _1, boost::ref(results), "third", boost::ref(mutex)));
+	producer.flush(boost::bind(&record_result, _1, boost::ref(results), "flush", boost::ref(mutex)));
+
+	boost::array<char, 1024> buffer;
+	const size_t request_size = 4 + 2 + 2 + 4 + 2 + strlen(kafkaconnect::default_client_id) + 2 + 4 + 4 + 2 + strlen("mice") + 4 + 4 + 4 + 26 + strlen("42");
+	boost::asio::read(socket, boost::asio::buffer(buffer.data(), 3 * request_size));
+
+	// answer the first and walk away from the other two
+	write_produce_response(socket, 1, 0);
+	socket.close();
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+	BOOST_CHECK_EQUAL(producer.is_connected(), false);
+	BOOST_CHECK_EQUAL(producer.send(messages, "mice", 0), false);
+
+	boost::mutex::scoped_lock lock(mutex);
+	BOOST_REQUIRE_EQUAL(results.size(), 4);
+	BOOST_CHECK_EQUAL(results[0], "first");
+	BOOST_CHECK_EQUAL(results[1].find("second:"), 0);
+	BOOST_CHECK_EQUAL(results[2].find("third:"), 0);
+	BOOST_CHECK_EQUAL(results[3], "flush");
+
+	work.reset();
+	io_service.stop();
+}
+
+BOOST_AUTO_TEST_CASE( destroyed_from_completion_test )
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io_service));
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 12345));
+	boost::thread bt(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	kafkaconnect::producer* producer = new kafkaconnect::producer(io_service);
+	producer->connect("localhost", 12345);
+
+	boost::asio::ip::tcp::socket socket(io_service);
+	acceptor.accept(socket);
+
+	while(!producer->is_connected())
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+
+	bool destroyed = false;
+	boost::array<std::string, 1> messages = { { "42" } };
+	producer->send(messages, "mice", 0, boost::bind(&destroy_producer, _1, boost::ref(producer), boost::ref(destroyed)));
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+	BOOST_CHECK(destroyed);
+
+	// the io thread is still free to run other work
+	boost::promise<void> ran;
+	io_service.post(boost::bind(&boost::promise<void>::set_value, &ran));
+	BOOST_CHECK(ran.get_future().timed_wait(boost::posix_time::milliseconds(500)));
+
+	work.reset();
+	io_service.stop();
+}